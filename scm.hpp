@@ -2,6 +2,7 @@
 
 #include <libguile.h>
 #include <complex>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <string>
@@ -69,6 +70,54 @@ struct scm {
 #undef DEF_CONSTRUCT_FROM
 };
 
+// typed conversions for subr trampolines: immediate fixnums and flonums are
+// handled inline with a single tag check, anything else falls back to the
+// generic scm_to_/scm_from_ path (which also does the error reporting)
+template <class T>
+using unboxed_t = remove_cv_t<remove_reference_t<T>>;
+
+template <class T>
+auto unbox(scm x) {
+  using U = unboxed_t<T>;
+  if constexpr(is_same_v<U, double>) {
+    if(SCM_I_INUMP(x.obj)) return (double)SCM_I_INUM(x.obj);
+    if(SCM_REALP(x.obj)) return SCM_REAL_VALUE(x.obj);
+    return (double)x;
+  } else if constexpr(is_same_v<U, bool>) {
+    return (bool)scm_is_true(x.obj);
+  } else if constexpr(is_integral_v<U>) {
+    if(SCM_I_INUMP(x.obj)) {
+      const scm_t_signed_bits i = SCM_I_INUM(x.obj);
+      if constexpr(is_signed_v<U>) {
+        if(i >= numeric_limits<U>::min() && i <= numeric_limits<U>::max())
+          return (U)i;
+      } else {
+        if(i >= 0 && (make_unsigned_t<scm_t_signed_bits>)i <=
+                         numeric_limits<U>::max())
+          return (U)i;
+      }
+    }
+    return (U)x;
+  } else {
+    return x;
+  }
+}
+
+template <class T>
+scm box(T&& val) {
+  using U = unboxed_t<T>;
+  if constexpr(is_integral_v<U> && !is_same_v<U, bool>) {
+    if constexpr(is_signed_v<U>) {
+      if(val >= SCM_MOST_NEGATIVE_FIXNUM && val <= SCM_MOST_POSITIVE_FIXNUM)
+        return SCM_I_MAKINUM(val);
+    } else {
+      if(val <= (make_unsigned_t<scm_t_signed_bits>)SCM_MOST_POSITIVE_FIXNUM)
+        return SCM_I_MAKINUM(val);
+    }
+  }
+  return scm{forward<T>(val)};
+}
+
 // do i want to do this with adl somehow? do i want to specify std::hash?
 template <class Key>
 struct hash;
@@ -42,12 +42,14 @@ struct wrap_helper {
         static scm wrapped(repeat<scm, reg_arg_t>... reg_arg,
                            repeat<scm, opt_arg_t>... opt_arg,
                            repeat<scm, rest_arg_t>... rest_arg) {
-#define FCALL f(reg_arg...)(opt_arg.toOpt()...)(rest_arg...)
+#define FCALL                                                                  \
+  f(unbox<tuple_element_t<reg_arg_t, reg_args>>(reg_arg)...)(                  \
+      opt_arg.toOpt()...)(rest_arg...)
           if constexpr(is_void_v<decltype(FCALL)>) {
             FCALL;
             return SCM_UNSPECIFIED;
           } else {
-            return scm{FCALL};
+            return box(FCALL);
           }
 #undef FCALL
         }
@@ -145,7 +147,11 @@ constexpr auto call_prim =
     wrap_helper<primitive>::template call<arg_t...>::callit;
 
 #define GUILE_SUBR_LAMBDA(reg_args, opt_args, rest_args, ...)                  \
-  [] reg_args { return [&] opt_args { return [&] rest_args { __VA_ARGS__ }; }; }
+  [] reg_args {                                                                \
+    return [=] opt_args mutable {                                              \
+      return [=] rest_args mutable { __VA_ARGS__ };                            \
+    };                                                                         \
+  }
 
 #define GUILE_DEF_SUBR(cname, scm_name, ...)                                   \
   namespace subr_impl {                                                        \
@@ -4,6 +4,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <array>
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
 #include "scm.hpp"
 #include "subr.hpp"
 
@@ -58,7 +63,6 @@ FILE* global_output;
 void draw_line(FILE* output, double x1, double y1, double x2, double y2) {
   fprintf(output, "plot [0:1] %f + %f * t, %f + %f * t notitle\n", x1, x2 - x1,
           y1, y2 - y1);
-  fflush(output);
 }
 
 double x, y;
@@ -87,21 +91,190 @@ GUILE_DEF_SUBR(tortoise_penup, "tortoise-penup", (), (), (), {
   return result;
 })
 
-GUILE_DEF_SUBR(tortoise_turn, "tortoise-turn", (const double degrees), (), (), {
-  direction += M_PI / 180.0 * degrees;
-  return scm{direction * 180.0 / M_PI};
-})
+void turn(const double degrees) { direction += M_PI / 180.0 * degrees; }
 
-GUILE_DEF_SUBR(tortoise_move, "tortoise-move", (const double length), (), (), {
+// does not flush global_output, callers do that once they are done drawing
+void move(const double length, const bool draw) {
   const double newX = x + length * cos(direction);
   const double newY = y + length * sin(direction);
 
-  if(pendown) draw_line(global_output, x, y, newX, newY);
+  if(draw) draw_line(global_output, x, y, newX, newY);
   x = newX;
   y = newY;
+}
+
+GUILE_DEF_SUBR(tortoise_turn, "tortoise-turn", (const double degrees), (), (), {
+  turn(degrees);
+  return scm{direction * 180.0 / M_PI};
+})
+
+GUILE_DEF_SUBR(tortoise_move, "tortoise-move", (const double length), (), (), {
+  move(length, pendown);
+  fflush(global_output);
 
   return list(x, y);
 })
+
+// Everything that can raise a scheme error is checked before any C++ state
+// exists, so no destructors are skipped by the non-local exit.
+void validate_lsystem(SCM axiom, SCM alist) {
+  SCM_ASSERT_TYPE(scm_is_string(axiom), axiom, SCM_ARG1, "tortoise-lsystem",
+                  "string");
+  // scm_ilength is -1 for improper and circular lists, both of which would
+  // keep the walks below (and in lsystem::load) from reaching '()
+  SCM_ASSERT_TYPE(scm_ilength(alist) >= 0, alist, SCM_ARG2, "tortoise-lsystem",
+                  "alist of (latin-1 char . string)");
+  for(SCM tail = alist; !scm_is_null(tail); tail = SCM_CDR(tail)) {
+    const SCM rule = SCM_CAR(tail);
+    SCM_ASSERT_TYPE(scm_is_pair(rule) && SCM_CHARP(SCM_CAR(rule)) &&
+                        SCM_CHAR(SCM_CAR(rule)) < 256 &&
+                        scm_is_string(SCM_CDR(rule)),
+                    alist, SCM_ARG2, "tortoise-lsystem",
+                    "alist of (latin-1 char . string)");
+  }
+}
+
+// latin-1, so every symbol is one byte and matches the 8 bit rule table. The
+// conversion can still fail on wider chars, so nothing is held across it.
+void append_latin1(string& out, SCM str) {
+  size_t len;
+  char* chars = scm_to_latin1_stringn(str, &len);
+  try {
+    out.append(chars, len);
+  } catch(...) {
+    free(chars);
+    throw;
+  }
+  free(chars);
+}
+
+// Productions are copied once into a single arena; expansion walks it
+// depth-first with one cursor per level that still has symbols left, so memory
+// does not depend on how many symbols the expansion yields. A symbol expanded
+// last in its production reuses its parent's cursor, so self-recursive rules
+// like A -> A stay at one cursor, but in the worst case (A -> AB) every level
+// keeps one and the stack reaches iterations + 1 cursors of 24 bytes each.
+struct lsystem {
+  struct production {
+    const char* begin;
+    const char* end;
+  };
+  struct cursor {
+    const char* pos;
+    const char* end;
+    unsigned int depth;
+  };
+  struct state {
+    double x, y, direction;
+  };
+
+  // symbols expanded between SCM_TICKs
+  static constexpr unsigned long tick_interval = 4096;
+
+  string arena;
+  production start;
+  array<optional<production>, 256> rules;
+  vector<cursor> stack;
+  vector<state> saved;
+
+  // rules is an alist of (char . string) already checked by
+  // validate_lsystem; like assv, the first binding wins
+  void load(SCM axiom, SCM alist) {
+    array<optional<pair<size_t, size_t>>, 256> spans;
+    append_latin1(arena, axiom);
+    const auto axiom_len = arena.size();
+    for(; !scm_is_null(alist); alist = SCM_CDR(alist)) {
+      const SCM rule = SCM_CAR(alist);
+      const auto sym = (unsigned char)SCM_CHAR(SCM_CAR(rule));
+      if(spans[sym]) continue;
+      const auto offset = arena.size();
+      append_latin1(arena, SCM_CDR(rule));
+      spans[sym] = pair{offset, arena.size() - offset};
+    }
+    // only take pointers once the arena has stopped growing
+    for(size_t sym = 0; sym < spans.size(); sym++)
+      if(auto span = spans[sym])
+        rules[sym] = production{arena.data() + span->first,
+                                arena.data() + span->first + span->second};
+    start = production{arena.data(), arena.data() + axiom_len};
+  }
+
+  // F and G draw, f moves with the pen up, + and - turn, [ and ] save and
+  // restore the turtle; every other symbol only takes part in rewriting
+  void run(const unsigned int iterations, const double length,
+           const double angle) {
+    stack.push_back({start.begin, start.end, 0});
+
+    for(unsigned long n = 1; !stack.empty(); n++) {
+      if(n % tick_interval == 0) SCM_TICK;
+
+      auto& top = stack.back();
+      if(top.pos == top.end) {
+        stack.pop_back();
+        continue;
+      }
+      const unsigned char sym = *top.pos++;
+      const auto depth = top.depth;
+      if(depth < iterations && rules[sym]) {
+        const cursor next{rules[sym]->begin, rules[sym]->end, depth + 1};
+        if(top.pos == top.end)
+          top = next;
+        else
+          stack.push_back(next);
+        continue;
+      }
+
+      switch(sym) {
+        case 'F':
+        case 'G': move(length, pendown); break;
+        case 'f': move(length, false); break;
+        case '+': turn(angle); break;
+        case '-': turn(-angle); break;
+        case '[': saved.push_back({x, y, direction}); break;
+        case ']':
+          if(!saved.empty()) {
+            x = saved.back().x;
+            y = saved.back().y;
+            direction = saved.back().direction;
+            saved.pop_back();
+          }
+          break;
+      }
+    }
+    fflush(global_output);
+  }
+};
+
+GUILE_DEF_SUBR(tortoise_lsystem, "tortoise-lsystem",
+               (scm axiom, scm rules, const unsigned int iterations,
+                const double length, const double angle),
+               (), (), {
+                 validate_lsystem(axiom, rules);
+
+                 // the dynwind owns the expansion state, so it is freed even
+                 // when a conversion error or an interrupt delivered at
+                 // SCM_TICK leaves through a non-local exit
+                 scm_dynwind_begin((scm_t_dynwind_flags)0);
+                 auto* sys = new(nothrow) lsystem;
+                 if(!sys) scm_memory_error("tortoise-lsystem");
+                 scm_dynwind_unwind_handler(
+                     [](void* p) { delete (lsystem*)p; }, sys,
+                     SCM_F_WIND_EXPLICITLY);
+
+                 // bad_alloc must not unwind through libguile's C frames;
+                 // turn it into a scheme error once the catch has finished
+                 bool out_of_memory = false;
+                 try {
+                   sys->load(axiom, rules);
+                   sys->run(iterations, length, angle);
+                 } catch(const bad_alloc&) {
+                   out_of_memory = true;
+                 }
+                 if(out_of_memory) scm_memory_error("tortoise-lsystem");
+                 scm_dynwind_end();
+
+                 return list(x, y);
+               })
 }  // namespace
 
 int main(int argc, char* argv[]) {
@@ -114,6 +287,7 @@ int main(int argc, char* argv[]) {
     DEFIT(pendown);
     DEFIT(turn);
     DEFIT(move);
+    DEFIT(lsystem);
 #undef DEFIT
   });
   tortoise_reset();